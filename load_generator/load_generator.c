@@ -0,0 +1,749 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+
+// User-space load generator for the char_device and concurrency drivers.
+// Each worker thread opens its own descriptor, picks operations from a
+// weighted mix and times every syscall. Results are reported as ops/sec,
+// MB/s and p50/p99/p999 latency, optionally as JSON so runs can be diffed.
+
+// IOCTL definitions, must match concurrency/concurrency.c
+#define CONCURRENCY_IOC_MAGIC 'k'
+#define IOCTL_SPINLOCK_INCREMENT _IO(CONCURRENCY_IOC_MAGIC, 1)
+#define IOCTL_ATOMIC_INCREMENT   _IO(CONCURRENCY_IOC_MAGIC, 2)
+#define IOCTL_ATOMIC_DECREMENT   _IO(CONCURRENCY_IOC_MAGIC, 3)
+#define IOCTL_GET_VALUES         _IOR(CONCURRENCY_IOC_MAGIC, 4, struct shared_data_values)
+
+struct shared_data_values {
+    int mutex_val;
+    int spinlock_val;
+    int atomic_val;
+    char buffer_val[256];
+};
+
+#define DEFAULT_DEVICE   "/dev/concurrency"
+#define DEFAULT_MIX      "read=40,write=40,spin_inc=10,get=10"
+#define DEFAULT_CHUNK    64
+#define DEFAULT_DURATION 10
+#define MAX_CHUNK        (1 << 20)
+#define MAX_DURATION     86400.0
+#define MAX_THREADS      4096
+
+enum op_type {
+    OP_READ,
+    OP_WRITE,
+    OP_SPIN_INC,
+    OP_ATOMIC_INC,
+    OP_ATOMIC_DEC,
+    OP_GET,
+    OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "read", "write", "spin_inc", "atomic_inc", "atomic_dec", "get"
+};
+
+// Latency histogram: values below HIST_SUB are recorded exactly, larger
+// values land in one of HIST_SUB linear sub-buckets per power of two,
+// which keeps the relative error of reported percentiles under ~3%.
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct op_stats {
+    uint64_t ops;
+    uint64_t errors;
+    int first_errno;    // errno of the first failure, kept so errors can be explained
+    uint64_t bytes;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t sum_ns;
+    uint64_t hist[HIST_BUCKETS];
+};
+
+struct config {
+    const char *device;
+    int threads;
+    int *cpus;
+    int ncpus;
+    unsigned int weights[OP_COUNT];
+    unsigned int total_weight;
+    char mix[256];
+    size_t chunk;
+    double duration;
+    const char *json_path;
+    int allow_errors;
+    uint64_t seed;
+    int seed_set;
+};
+
+struct worker {
+    pthread_t thread;
+    int id;
+    int cpu;
+    int fd;
+    char *buf;
+    uint64_t rng;
+    struct op_stats stats[OP_COUNT];
+};
+
+static struct config cfg;
+static pthread_barrier_t start_barrier;
+static atomic_int stop_flag;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned int hist_index(uint64_t v) {
+    int msb, shift;
+
+    if (v < HIST_SUB)
+        return (unsigned int)v;
+
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - HIST_SUB_BITS;
+    return (unsigned int)((shift + 1) * HIST_SUB + ((v >> shift) - HIST_SUB));
+}
+
+// Midpoint of the value range covered by a bucket
+static uint64_t hist_value(unsigned int idx) {
+    int shift;
+
+    if (idx < HIST_SUB)
+        return idx;
+
+    shift = (int)(idx / HIST_SUB) - 1;
+    return ((uint64_t)(HIST_SUB + idx % HIST_SUB) << shift) + ((1ULL << shift) >> 1);
+}
+
+static void stats_record(struct op_stats *s, uint64_t ns, ssize_t bytes) {
+    if (s->ops == 0 || ns < s->min_ns)
+        s->min_ns = ns;
+    if (ns > s->max_ns)
+        s->max_ns = ns;
+    s->ops++;
+    s->sum_ns += ns;
+    s->hist[hist_index(ns)]++;
+    if (bytes > 0)
+        s->bytes += (uint64_t)bytes;
+}
+
+static void stats_merge(struct op_stats *dst, const struct op_stats *src) {
+    unsigned int i;
+
+    if (!dst->first_errno)
+        dst->first_errno = src->first_errno;
+    if (src->ops == 0) {
+        dst->errors += src->errors;
+        return;
+    }
+    if (dst->ops == 0 || src->min_ns < dst->min_ns)
+        dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+    dst->ops += src->ops;
+    dst->errors += src->errors;
+    dst->bytes += src->bytes;
+    dst->sum_ns += src->sum_ns;
+    for (i = 0; i < HIST_BUCKETS; i++)
+        dst->hist[i] += src->hist[i];
+}
+
+static uint64_t stats_percentile(const struct op_stats *s, double pct) {
+    uint64_t permille, rank, seen = 0;
+    unsigned int i;
+
+    if (s->ops == 0)
+        return 0;
+
+    // Nearest-rank: the ceil(pct% * n)-th smallest sample, as a 0-based index.
+    // Done in integer per-mille so 99.9% of 1000 is exactly 999, not 999.0000001.
+    permille = (uint64_t)llround(pct * 10.0);
+    rank = (permille * s->ops + 999) / 1000;
+    rank = rank ? rank - 1 : 0;
+    if (rank >= s->ops)
+        rank = s->ops - 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += s->hist[i];
+        if (seen > rank) {
+            uint64_t v = hist_value(i);
+            // Never report outside the observed range
+            if (v < s->min_ns)
+                v = s->min_ns;
+            if (v > s->max_ns)
+                v = s->max_ns;
+            return v;
+        }
+    }
+    return s->max_ns;
+}
+
+// xorshift64*, one state per thread so op selection needs no locking
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static enum op_type pick_op(struct worker *w) {
+    unsigned int r = (unsigned int)(rng_next(&w->rng) % cfg.total_weight);
+    int op;
+
+    for (op = 0; op < OP_COUNT - 1; op++) {
+        if (r < cfg.weights[op])
+            break;
+        r -= cfg.weights[op];
+    }
+    return (enum op_type)op;
+}
+
+static ssize_t run_op(struct worker *w, enum op_type op, char *buf) {
+    struct shared_data_values values;
+
+    switch (op) {
+        case OP_READ:
+            // pread/pwrite at offset 0 so char_device never runs off the
+            // end of its fixed-size buffer; concurrency ignores the offset.
+            return pread(w->fd, buf, cfg.chunk, 0);
+        case OP_WRITE:
+            return pwrite(w->fd, buf, cfg.chunk, 0);
+        case OP_SPIN_INC:
+            return ioctl(w->fd, IOCTL_SPINLOCK_INCREMENT);
+        case OP_ATOMIC_INC:
+            return ioctl(w->fd, IOCTL_ATOMIC_INCREMENT);
+        case OP_ATOMIC_DEC:
+            return ioctl(w->fd, IOCTL_ATOMIC_DECREMENT);
+        case OP_GET:
+            return ioctl(w->fd, IOCTL_GET_VALUES, &values);
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+
+    pthread_barrier_wait(&start_barrier);
+
+    while (!atomic_load_explicit(&stop_flag, memory_order_relaxed)) {
+        enum op_type op = pick_op(w);
+        uint64_t start, end;
+        ssize_t ret;
+
+        start = now_ns();
+        ret = run_op(w, op, w->buf);
+        end = now_ns();
+
+        if (ret < 0) {
+            if (!w->stats[op].errors++)
+                w->stats[op].first_errno = errno;
+        } else
+            stats_record(&w->stats[op], end - start, op <= OP_WRITE ? ret : 0);
+    }
+
+    return NULL;
+}
+
+static int parse_mix(const char *spec) {
+    char *copy, *tok, *save = NULL;
+    int op;
+
+    memset(cfg.weights, 0, sizeof(cfg.weights));
+    cfg.total_weight = 0;
+
+    copy = strdup(spec);
+    if (!copy)
+        return -1;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        char *end;
+        unsigned long weight = 1;
+
+        if (eq) {
+            *eq = '\0';
+            weight = strtoul(eq + 1, &end, 10);
+            if (*(eq + 1) == '\0' || *end != '\0' || weight > 1000000) {
+                fprintf(stderr, "Invalid weight for '%s'\n", tok);
+                free(copy);
+                return -1;
+            }
+        }
+
+        for (op = 0; op < OP_COUNT; op++) {
+            if (strcmp(tok, op_names[op]) == 0)
+                break;
+        }
+        if (op == OP_COUNT) {
+            fprintf(stderr, "Unknown operation '%s'\n", tok);
+            free(copy);
+            return -1;
+        }
+        cfg.weights[op] += (unsigned int)weight;
+        cfg.total_weight += (unsigned int)weight;
+    }
+    free(copy);
+
+    if (cfg.total_weight == 0) {
+        fprintf(stderr, "Operation mix has no weight\n");
+        return -1;
+    }
+    snprintf(cfg.mix, sizeof(cfg.mix), "%s", spec);
+    return 0;
+}
+
+// Accepts a list such as "0,2,4-7"
+static int parse_cpus(const char *spec) {
+    const char *p = spec;
+    int cap = 0;
+
+    cfg.ncpus = 0;
+    while (*p) {
+        char *end;
+        long lo, hi, c;
+
+        lo = strtol(p, &end, 10);
+        if (end == p || lo < 0)
+            goto bad;
+        hi = lo;
+        p = end;
+        if (*p == '-') {
+            p++;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                goto bad;
+            p = end;
+        }
+        if (hi >= CPU_SETSIZE)
+            goto bad;
+        for (c = lo; c <= hi; c++) {
+            if (cfg.ncpus == cap) {
+                int *tmp;
+
+                cap = cap ? cap * 2 : 16;
+                tmp = realloc(cfg.cpus, (size_t)cap * sizeof(*cfg.cpus));
+                if (!tmp)
+                    return -1;
+                cfg.cpus = tmp;
+            }
+            cfg.cpus[cfg.ncpus++] = (int)c;
+        }
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            goto bad;
+    }
+    if (cfg.ncpus == 0)
+        goto bad;
+    return 0;
+
+bad:
+    fprintf(stderr, "Invalid CPU list '%s'\n", spec);
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -d, --device PATH     device node (default %s)\n"
+            "  -t, --threads N       worker threads (default 1)\n"
+            "  -c, --cpus LIST       pin threads round-robin to CPUs, e.g. 0,2,4-7\n"
+            "  -m, --mix SPEC        weighted op mix (default %s)\n"
+            "                        ops: read write spin_inc atomic_inc atomic_dec get\n"
+            "  -s, --chunk BYTES     read/write size (default %d)\n"
+            "  -D, --duration SECS   run time, at most %.0f (default %d)\n"
+            "  -j, --json PATH       write JSON report to PATH ('-' for stdout)\n"
+            "  -S, --seed N          seed for the op mix (default: time based)\n"
+            "  -E, --allow-errors    exit 0 even if some operations failed\n"
+            "  -h, --help            show this help\n",
+            prog, DEFAULT_DEVICE, DEFAULT_MIX, DEFAULT_CHUNK, MAX_DURATION, DEFAULT_DURATION);
+}
+
+static int parse_args(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "device",   required_argument, NULL, 'd' },
+        { "threads",  required_argument, NULL, 't' },
+        { "cpus",     required_argument, NULL, 'c' },
+        { "mix",      required_argument, NULL, 'm' },
+        { "chunk",    required_argument, NULL, 's' },
+        { "duration", required_argument, NULL, 'D' },
+        { "json",     required_argument, NULL, 'j' },
+        { "seed",     required_argument, NULL, 'S' },
+        { "allow-errors", no_argument,   NULL, 'E' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    char *end;
+
+    cfg.device = DEFAULT_DEVICE;
+    cfg.threads = 1;
+    cfg.chunk = DEFAULT_CHUNK;
+    cfg.duration = DEFAULT_DURATION;
+    if (parse_mix(DEFAULT_MIX) < 0)
+        return -1;
+
+    while ((opt = getopt_long(argc, argv, "d:t:c:m:s:D:j:S:Eh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                cfg.device = optarg;
+                break;
+            case 't': {
+                long threads;
+
+                errno = 0;
+                threads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || errno == ERANGE ||
+                    threads < 1 || threads > MAX_THREADS) {
+                    fprintf(stderr, "Invalid thread count '%s'\n", optarg);
+                    return -1;
+                }
+                cfg.threads = (int)threads;
+                break;
+            }
+            case 'c':
+                if (parse_cpus(optarg) < 0)
+                    return -1;
+                break;
+            case 'm':
+                if (parse_mix(optarg) < 0)
+                    return -1;
+                break;
+            case 's':
+                cfg.chunk = (size_t)strtoul(optarg, &end, 10);
+                if (*end != '\0' || cfg.chunk < 1 || cfg.chunk > MAX_CHUNK) {
+                    fprintf(stderr, "Invalid chunk size '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'D':
+                cfg.duration = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || !isfinite(cfg.duration) ||
+                    cfg.duration <= 0 || cfg.duration > MAX_DURATION) {
+                    fprintf(stderr, "Invalid duration '%s'\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'j':
+                cfg.json_path = optarg;
+                break;
+            case 'S':
+                errno = 0;
+                cfg.seed = strtoull(optarg, &end, 0);
+                if (end == optarg || *end != '\0' || errno == ERANGE || optarg[0] == '-') {
+                    fprintf(stderr, "Invalid seed '%s'\n", optarg);
+                    return -1;
+                }
+                cfg.seed_set = 1;
+                break;
+            case 'E':
+                cfg.allow_errors = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                exit(0);
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+    if (optind != argc) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_text_line(FILE *out, const char *name, const struct op_stats *s, double elapsed) {
+    fprintf(out, "%-11s %12llu %8llu %12.1f %10.3f %10.2f %10.2f %10.2f %10.2f\n",
+            name,
+            (unsigned long long)s->ops,
+            (unsigned long long)s->errors,
+            s->ops / elapsed,
+            s->bytes / elapsed / 1e6,
+            s->ops ? (double)s->sum_ns / s->ops / 1000.0 : 0.0,
+            stats_percentile(s, 50.0) / 1000.0,
+            stats_percentile(s, 99.0) / 1000.0,
+            stats_percentile(s, 99.9) / 1000.0);
+}
+
+static void print_text(FILE *out, const struct op_stats *per_op, const struct op_stats *total, double elapsed) {
+    int op;
+
+    fprintf(out, "device %s, %d thread(s), chunk %zu bytes, mix %s, seed %llu, %.2f s\n",
+            cfg.device, cfg.threads, cfg.chunk, cfg.mix, (unsigned long long)cfg.seed, elapsed);
+    fprintf(out, "%-11s %12s %8s %12s %10s %10s %10s %10s %10s\n",
+            "op", "ops", "errors", "ops/sec", "MB/s", "avg(us)", "p50(us)", "p99(us)", "p999(us)");
+    for (op = 0; op < OP_COUNT; op++) {
+        if (cfg.weights[op])
+            print_text_line(out, op_names[op], &per_op[op], elapsed);
+    }
+    print_text_line(out, "total", total, elapsed);
+
+    for (op = 0; op < OP_COUNT; op++) {
+        if (per_op[op].errors)
+            fprintf(out, "%s: %llu error(s), first: %s (errno %d)\n",
+                    op_names[op], (unsigned long long)per_op[op].errors,
+                    strerror(per_op[op].first_errno), per_op[op].first_errno);
+    }
+}
+
+// Strings written here come from the command line or strerror, escape the JSON specials
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void print_json_stats(FILE *out, const struct op_stats *s, double elapsed) {
+    fprintf(out,
+            "{\"ops\": %llu, \"errors\": %llu, \"bytes\": %llu, "
+            "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+            "\"latency_ns\": {\"min\": %llu, \"avg\": %.1f, \"p50\": %llu, "
+            "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+            (unsigned long long)s->ops,
+            (unsigned long long)s->errors,
+            (unsigned long long)s->bytes,
+            s->ops / elapsed,
+            s->bytes / elapsed / 1e6,
+            (unsigned long long)s->min_ns,
+            s->ops ? (double)s->sum_ns / s->ops : 0.0,
+            (unsigned long long)stats_percentile(s, 50.0),
+            (unsigned long long)stats_percentile(s, 99.0),
+            (unsigned long long)stats_percentile(s, 99.9),
+            (unsigned long long)s->max_ns);
+    if (s->errors) {
+        fprintf(out, ", \"first_errno\": %d, \"first_error\": ", s->first_errno);
+        print_json_string(out, strerror(s->first_errno));
+    }
+    fputc('}', out);
+}
+
+static void print_json(FILE *out, const struct worker *workers, const struct op_stats *per_op,
+                       const struct op_stats *total, double elapsed) {
+    struct utsname uts;
+    int op, i, first;
+
+    fprintf(out, "{\n  \"config\": {\"device\": ");
+    print_json_string(out, cfg.device);
+    fprintf(out, ", \"threads\": %d, \"chunk\": %zu, \"duration_s\": %.3f, \"seed\": %llu, \"mix\": {",
+            cfg.threads, cfg.chunk, cfg.duration, (unsigned long long)cfg.seed);
+    for (op = 0, first = 1; op < OP_COUNT; op++) {
+        if (!cfg.weights[op])
+            continue;
+        fprintf(out, "%s\"%s\": %u", first ? "" : ", ", op_names[op], cfg.weights[op]);
+        first = 0;
+    }
+    fprintf(out, "}, \"cpus\": [");
+    for (i = 0; i < cfg.threads; i++)
+        fprintf(out, "%s%d", i ? ", " : "", workers[i].cpu);
+    fprintf(out, "]");
+    if (uname(&uts) == 0) {
+        fprintf(out, ", \"kernel\": ");
+        print_json_string(out, uts.release);
+    }
+    fprintf(out, "},\n  \"elapsed_s\": %.3f,\n  \"ops\": {", elapsed);
+    for (op = 0, first = 1; op < OP_COUNT; op++) {
+        if (!cfg.weights[op])
+            continue;
+        fprintf(out, "%s\n    \"%s\": ", first ? "" : ",", op_names[op]);
+        print_json_stats(out, &per_op[op], elapsed);
+        first = 0;
+    }
+    fprintf(out, "\n  },\n  \"total\": ");
+    print_json_stats(out, total, elapsed);
+    fprintf(out, "\n}\n");
+}
+
+int main(int argc, char **argv) {
+    struct worker *workers;
+    struct op_stats *per_op, *total;
+    struct timespec ts;
+    FILE *json_out = NULL;
+    uint64_t start, end;
+    double elapsed;
+    int i, op, ret = 0;
+
+    if (parse_args(argc, argv) < 0)
+        return 1;
+
+    // Reject CPUs outside our affinity mask before any thread is started
+    if (cfg.ncpus) {
+        cpu_set_t allowed;
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (i = 0; i < cfg.ncpus; i++) {
+                if (!CPU_ISSET(cfg.cpus[i], &allowed)) {
+                    fprintf(stderr, "CPU %d is not available to this process\n", cfg.cpus[i]);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    workers = calloc((size_t)cfg.threads, sizeof(*workers));
+    per_op = calloc(OP_COUNT, sizeof(*per_op));
+    total = calloc(1, sizeof(*total));
+    if (!workers || !per_op || !total) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Allocate every I/O buffer up front so all threads requested actually run
+    for (i = 0; i < cfg.threads; i++) {
+        workers[i].buf = malloc(cfg.chunk);
+        if (!workers[i].buf) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        memset(workers[i].buf, 'a' + i % 26, cfg.chunk);
+    }
+
+    // Open every descriptor up front so a bad path fails before any load runs
+    // Each thread derives its op sequence from the seed, so passing the
+    // reported seed back with -S replays the same per-thread mix. The
+    // default is kept below 2^53 so JSON readers hold it exactly.
+    if (!cfg.seed_set)
+        cfg.seed = (now_ns() ^ (uint64_t)getpid()) & ((1ULL << 53) - 1);
+    for (i = 0; i < cfg.threads; i++) {
+        workers[i].id = i;
+        workers[i].cpu = cfg.ncpus ? cfg.cpus[i % cfg.ncpus] : -1;
+        workers[i].rng = (cfg.seed + (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL) | 1;
+        workers[i].fd = open(cfg.device, O_RDWR);
+        if (workers[i].fd < 0) {
+            fprintf(stderr, "Failed to open %s: %s\n", cfg.device, strerror(errno));
+            while (--i >= 0)
+                close(workers[i].fd);
+            return 1;
+        }
+    }
+
+    // Same for the JSON report, so a bad path does not discard a finished run
+    if (cfg.json_path && strcmp(cfg.json_path, "-") == 0) {
+        json_out = stdout;
+    } else if (cfg.json_path) {
+        json_out = fopen(cfg.json_path, "w");
+        if (!json_out) {
+            fprintf(stderr, "Failed to open %s: %s\n", cfg.json_path, strerror(errno));
+            for (i = 0; i < cfg.threads; i++)
+                close(workers[i].fd);
+            return 1;
+        }
+    }
+
+    ret = pthread_barrier_init(&start_barrier, NULL, (unsigned int)cfg.threads + 1);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to create start barrier: %s\n", strerror(ret));
+        return 1;
+    }
+
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_attr_t attr;
+
+        ret = pthread_attr_init(&attr);
+        if (ret == 0) {
+            if (workers[i].cpu >= 0) {
+                cpu_set_t set;
+
+                CPU_ZERO(&set);
+                CPU_SET(workers[i].cpu, &set);
+                ret = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+            }
+            if (ret == 0)
+                ret = pthread_create(&workers[i].thread, &attr, worker_main, &workers[i]);
+            pthread_attr_destroy(&attr);
+        }
+        if (ret != 0) {
+            fprintf(stderr, "Failed to start thread %d: %s\n", i, strerror(ret));
+            // Threads already started are parked on the barrier, nothing to
+            // unwind cleanly; exiting releases their descriptors.
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    start = now_ns();
+
+    ts.tv_sec = (time_t)cfg.duration;
+    ts.tv_nsec = (long)((cfg.duration - (double)ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+
+    atomic_store(&stop_flag, 1);
+    for (i = 0; i < cfg.threads; i++)
+        pthread_join(workers[i].thread, NULL);
+    end = now_ns();
+    elapsed = (double)(end - start) / 1e9;
+
+    for (i = 0; i < cfg.threads; i++) {
+        close(workers[i].fd);
+        free(workers[i].buf);
+        for (op = 0; op < OP_COUNT; op++) {
+            stats_merge(&per_op[op], &workers[i].stats[op]);
+            stats_merge(total, &workers[i].stats[op]);
+        }
+    }
+
+    // Keep stdout clean for JSON when it is the requested destination
+    print_text(json_out == stdout ? stderr : stdout, per_op, total, elapsed);
+    if (json_out) {
+        print_json(json_out, workers, per_op, total, elapsed);
+        if (json_out != stdout) {
+            int failed = ferror(json_out);
+
+            if (fclose(json_out) != 0 || failed) {
+                fprintf(stderr, "Failed to write %s: %s\n", cfg.json_path, strerror(errno));
+                ret = 1;
+            }
+        }
+    }
+
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        fprintf(stderr, "Failed to write to stdout: %s\n", strerror(errno));
+        ret = 1;
+    }
+    // A driver build that fails operations must not pass a scripted gate
+    if (total->errors) {
+        fprintf(stderr, "%s: %llu operation(s) failed\n",
+                cfg.allow_errors ? "Warning" : "Error", (unsigned long long)total->errors);
+        if (!cfg.allow_errors)
+            ret = 1;
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+    free(cfg.cpus);
+    free(workers);
+    free(per_op);
+    free(total);
+    return ret;
+}